@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+template <size_t width>
+struct byte_key {
+    std::array<unsigned char, width> bytes{};
+
+    friend inline bool operator<(const byte_key& left, const byte_key& right) {
+        if constexpr (width <= sizeof(uint64_t)) {
+            return left.high_word() < right.high_word();
+        } else if constexpr (width <= 2 * sizeof(uint64_t)) {
+            uint64_t left_high = left.high_word(), right_high = right.high_word();
+            if (left_high != right_high)
+                return left_high < right_high;
+            return left.low_word() < right.low_word();
+        } else {
+            return std::memcmp(left.bytes.data(), right.bytes.data(), width) < 0;
+        }
+    }
+    friend inline bool operator>(const byte_key& left, const byte_key& right) { return right < left; }
+    friend inline bool operator==(const byte_key& left, const byte_key& right) { return left.bytes == right.bytes; }
+    friend inline bool operator!=(const byte_key& left, const byte_key& right) { return !(left == right); }
+
+private:
+    static inline uint64_t load_word(const unsigned char* data, size_t length) {
+        uint64_t word = 0;
+        std::memcpy(&word, data, length);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return word;
+#else
+        return __builtin_bswap64(word);
+#endif
+    }
+
+    inline uint64_t high_word() const { return load_word(bytes.data(), std::min(width, sizeof(uint64_t))); }
+    inline uint64_t low_word() const { return load_word(bytes.data() + sizeof(uint64_t), width - sizeof(uint64_t)); }
+};
+
+template <typename Field>
+inline void encode_field(unsigned char*& out, Field field) {
+    static_assert(std::is_arithmetic_v<Field>, "Key fields must be arithmetic");
+    using bits_type = std::conditional_t<sizeof(Field) == 1, uint8_t,
+                      std::conditional_t<sizeof(Field) == 2, uint16_t,
+                      std::conditional_t<sizeof(Field) == 4, uint32_t, uint64_t>>>;
+    constexpr bits_type sign_bit = bits_type(1) << (8 * sizeof(Field) - 1);
+
+    bits_type bits;
+    std::memcpy(&bits, &field, sizeof(Field));
+    if constexpr (std::is_floating_point_v<Field>)
+        bits = (bits & sign_bit) ? bits_type(~bits) : bits_type(bits | sign_bit);
+    else if constexpr (std::is_signed_v<Field>)
+        bits ^= sign_bit;
+
+    for (int shift = 8 * (sizeof(Field) - 1); shift >= 0; shift -= 8)
+        *out++ = (unsigned char)(bits >> shift);
+}
+
+template <typename Field>
+inline Field decode_field(const unsigned char*& in) {
+    using bits_type = std::conditional_t<sizeof(Field) == 1, uint8_t,
+                      std::conditional_t<sizeof(Field) == 2, uint16_t,
+                      std::conditional_t<sizeof(Field) == 4, uint32_t, uint64_t>>>;
+    constexpr bits_type sign_bit = bits_type(1) << (8 * sizeof(Field) - 1);
+
+    bits_type bits = 0;
+    for (size_t i = 0; i < sizeof(Field); ++i)
+        bits = bits_type((bits << 8) | *in++);
+    if constexpr (std::is_floating_point_v<Field>)
+        bits = (bits & sign_bit) ? bits_type(bits & ~sign_bit) : bits_type(~bits);
+    else if constexpr (std::is_signed_v<Field>)
+        bits ^= sign_bit;
+
+    Field field;
+    std::memcpy(&field, &bits, sizeof(Field));
+    return field;
+}
+
+template <typename... Fields>
+inline byte_key<(sizeof(Fields) + ...)> encode_key(Fields... fields) {
+    byte_key<(sizeof(Fields) + ...)> key;
+    unsigned char* out = key.bytes.data();
+    (encode_field(out, fields), ...);
+    return key;
+}
+
+template <typename... Fields>
+inline std::tuple<Fields...> decode_key(const byte_key<(sizeof(Fields) + ...)>& key) {
+    const unsigned char* in = key.bytes.data();
+    return std::tuple<Fields...>{decode_field<Fields>(in)...};
+}
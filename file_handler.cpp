@@ -62,16 +62,30 @@ int main(int argc, char* argv[]) {
 
             int value = std::stoi(tokens[1]);
             output_file << pma.successor(value) << std::endl;
+        } else if (tokens.front() == "MIN" || tokens.front() == "MAX" || tokens.front() == "POP") {
+            if (tokens.size() != 1) {
+                std::cerr << "Error on " << tokens.front() << std::endl;
+                std::cerr << "line " << line_count << ": " << line << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            if (!pma.empty()) {
+                if (tokens.front() == "MIN")
+                    output_file << pma.min();
+                else if (tokens.front() == "MAX")
+                    output_file << pma.max();
+                else
+                    output_file << pma.pop_min();
+            }
+            output_file << std::endl;
         } else if (tokens.front() == "IMP") {
             if (tokens.size() != 1) {
                 std::cerr << "Error on IMP" << std::endl;
                 std::cerr << "line " << line_count << ": " << line << std::endl;
                 return EXIT_FAILURE;
             }
-            for (const auto& item : pma) {
-                if (item) 
-                    output_file << item.value() << ' ';
-            }
+            for (const auto& item : pma.values())
+                output_file << item << ' ';
             output_file << std::endl;
         } else {
             if (!tokens.empty()) {
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+
+#include "packed_memory_array.h"
+
+template <uint32_t chunk_size = 8>
+class morton_array {
+public:
+    inline void push(uint32_t x, uint32_t y) { pma.push(encode(x, y)); }
+    inline void remove(uint32_t x, uint32_t y) { pma.remove(encode(x, y)); }
+
+    inline int size() const { return pma.size(); }
+    inline bool empty() const { return pma.empty(); }
+
+    template <typename Callback>
+    inline void query(uint32_t x_min, uint32_t y_min, uint32_t x_max, uint32_t y_max, Callback callback) const {
+        uint64_t low = encode(x_min, y_min), high = encode(x_max, y_max);
+        auto it = pma.lower_bound(pma.begin(), low);
+        while (it != pma.end() && it->value() <= high) {
+            uint64_t code = it->value();
+            uint32_t x = compact(code), y = compact(code >> 1);
+            if (x_min <= x && x <= x_max && y_min <= y && y <= y_max) {
+                callback(x, y);
+                for (++it; it != pma.end() && !*it; ++it);
+            } else {
+                it = pma.lower_bound(it, bigmin(code, low, high));
+            }
+        }
+    }
+
+    static inline uint64_t encode(uint32_t x, uint32_t y) { return spread(x) | (spread(y) << 1); }
+
+private:
+    packed_memory_array<uint64_t, std::less<uint64_t>, chunk_size> pma;
+
+    static inline uint64_t spread(uint32_t value) {
+        uint64_t bits = value;
+        bits = (bits | (bits << 16)) & 0x0000FFFF0000FFFFull;
+        bits = (bits | (bits << 8)) & 0x00FF00FF00FF00FFull;
+        bits = (bits | (bits << 4)) & 0x0F0F0F0F0F0F0F0Full;
+        bits = (bits | (bits << 2)) & 0x3333333333333333ull;
+        bits = (bits | (bits << 1)) & 0x5555555555555555ull;
+        return bits;
+    }
+
+    static inline uint32_t compact(uint64_t bits) {
+        bits &= 0x5555555555555555ull;
+        bits = (bits | (bits >> 1)) & 0x3333333333333333ull;
+        bits = (bits | (bits >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+        bits = (bits | (bits >> 4)) & 0x00FF00FF00FF00FFull;
+        bits = (bits | (bits >> 8)) & 0x0000FFFF0000FFFFull;
+        bits = (bits | (bits >> 16)) & 0x00000000FFFFFFFFull;
+        return (uint32_t)bits;
+    }
+
+    static inline uint64_t bigmin(uint64_t code, uint64_t low, uint64_t high) {
+        uint64_t result = low;
+        for (int bit = 63; bit >= 0; --bit) {
+            uint64_t mask = 1ull << bit;
+            uint64_t below = (mask - 1) & ((bit % 2 == 0) ? 0x5555555555555555ull : 0xAAAAAAAAAAAAAAAAull);
+            bool code_bit = code & mask, low_bit = low & mask, high_bit = high & mask;
+            if (!code_bit && !low_bit && high_bit) {
+                result = (low | mask) & ~below;
+                high = (high & ~mask) | below;
+            } else if (!code_bit && low_bit && high_bit) {
+                return low;
+            } else if (code_bit && !low_bit && !high_bit) {
+                return result;
+            } else if (code_bit && !low_bit && high_bit) {
+                low = (low | mask) & ~below;
+            }
+        }
+
+        return result;
+    }
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "packed_memory_array.h"
+
+struct price_level {
+    int64_t price;
+    int64_t quantity;
+};
+
+struct level_price {
+    inline int64_t operator()(const price_level& level) const { return level.price; }
+};
+
+struct level_quantity {
+    using value_type = int64_t;
+    static inline int64_t lift(const price_level& level) { return level.quantity; }
+    static inline int64_t identity() { return 0; }
+    static inline int64_t combine(int64_t left, int64_t right) { return left + right; }
+};
+
+struct level_update {
+    bool bid;
+    int64_t price;
+    int64_t quantity;
+};
+
+template <uint32_t chunk_size = 8>
+class order_book {
+public:
+    using level_array = packed_memory_array<price_level, std::less<int64_t>, chunk_size, level_quantity, level_price>;
+
+    inline void set_level(bool bid, int64_t price, int64_t quantity) {
+        level_array& levels = bid ? bids : asks;
+        set_level(levels, levels.begin(), {price, quantity});
+    }
+
+    inline void apply(std::vector<level_update> updates) {
+        std::stable_sort(updates.begin(), updates.end(), [](const level_update& left, const level_update& right) {
+            return left.bid != right.bid ? left.bid < right.bid : left.price < right.price;
+        });
+
+        int hint = 0;
+        for (size_t i = 0; i < updates.size(); ++i) {
+            if (i > 0 && updates[i].bid != updates[i - 1].bid)
+                hint = 0;
+
+            level_array& levels = updates[i].bid ? bids : asks;
+            int slots = levels.end() - levels.begin();
+            hint = set_level(levels, levels.begin() + std::min(hint, slots - 1), {updates[i].price, updates[i].quantity});
+        }
+    }
+
+    inline bool has_bid() const { return !bids.empty(); }
+    inline bool has_ask() const { return !asks.empty(); }
+    inline const price_level& best_bid() const { return bids.max(); }
+    inline const price_level& best_ask() const { return asks.min(); }
+
+    inline int64_t bid_depth(int64_t limit_price) const {
+        return bids.aggregate(limit_price, std::numeric_limits<int64_t>::max());
+    }
+
+    inline int64_t ask_depth(int64_t limit_price) const {
+        return asks.aggregate(std::numeric_limits<int64_t>::lowest(), limit_price);
+    }
+
+    inline int bid_levels() const { return bids.size(); }
+    inline int ask_levels() const { return asks.size(); }
+
+    inline const level_array& bid_side() const { return bids; }
+    inline const level_array& ask_side() const { return asks; }
+
+private:
+    level_array bids;
+    level_array asks;
+
+    static inline int set_level(level_array& levels, typename level_array::const_iterator hint, const price_level& level) {
+        auto it = levels.empty() ? levels.end() : levels.lower_bound(hint, level.price);
+        bool found = it != levels.end() && it->value().price == level.price;
+        int slot = it == levels.end() ? 0 : it - levels.begin();
+
+        if (level.quantity == 0) {
+            if (found)
+                levels.remove(level.price);
+        } else if (found) {
+            levels.update(it->value(), level);
+        } else {
+            slot = levels.insert(it == levels.end() ? hint : it, level) - levels.begin();
+        }
+
+        return slot;
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "packed_memory_array.h"
+
+template <uint32_t chunk_size = 8>
+class packed_csr {
+public:
+    inline uint32_t add_vertex() {
+        uint32_t vertex = offsets.size();
+        auto sentinel = edges.insert(edges.begin(), edge_key(vertex, 0));
+        offsets.push_back(sentinel - edges.begin());
+        return vertex;
+    }
+
+    inline void add_edge(uint32_t source, uint32_t target) {
+        if (target == std::numeric_limits<uint32_t>::max())
+            return;
+
+        for (; offsets.size() <= std::max(source, target); add_vertex());
+
+        auto sentinel = locate(source);
+        offsets[source] = sentinel - edges.begin();
+        uint64_t key = edge_key(source, target + 1);
+        if (edges.find(sentinel, key) == edges.end()) {
+            edges.insert(sentinel, key);
+            ++edge_count;
+        }
+    }
+
+    inline void remove_edge(uint32_t source, uint32_t target) {
+        if (source >= offsets.size() || target == std::numeric_limits<uint32_t>::max())
+            return;
+
+        offsets[source] = locate(source) - edges.begin();
+        int count = edges.size();
+        edges.remove(edge_key(source, target + 1));
+        edge_count -= count - edges.size();
+    }
+
+    template <typename Callback>
+    inline void for_each_neighbour(uint32_t vertex, Callback callback) const {
+        if (vertex >= offsets.size())
+            return;
+
+        auto it = locate(vertex);
+        for (++it; it != edges.end() && (!*it || (uint32_t)(it->value() >> 32) == vertex); ++it) {
+            if (*it)
+                callback((uint32_t)it->value() - 1);
+        }
+    }
+
+    inline int vertices() const { return offsets.size(); }
+    inline int edges_size() const { return edge_count; }
+
+private:
+    packed_memory_array<uint64_t, std::less<uint64_t>, chunk_size> edges;
+    std::vector<int> offsets;
+    int edge_count = 0;
+
+    static inline uint64_t edge_key(uint32_t source, uint32_t target) {
+        return ((uint64_t)source << 32) | target;
+    }
+
+    inline auto locate(uint32_t vertex) const {
+        int slots = edges.end() - edges.begin();
+        return edges.lower_bound(edges.begin() + std::min(offsets[vertex], slots - 1), edge_key(vertex, 0));
+    }
+};
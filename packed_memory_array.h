@@ -2,98 +2,743 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <random>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
-template <typename ItemType, typename Comparator = std::less<ItemType>, uint32_t chunk_size = 8>
+struct no_aggregate {
+    using value_type = bool;
+    template <typename ItemType>
+    static inline bool lift(const ItemType&) { return false; }
+    static inline bool identity() { return false; }
+    static inline bool combine(bool, bool) { return false; }
+};
+
+template <typename ValueType>
+struct sum_aggregate {
+    using value_type = ValueType;
+    static inline ValueType lift(const ValueType& item) { return item; }
+    static inline ValueType identity() { return ValueType(); }
+    static inline ValueType combine(const ValueType& left, const ValueType& right) { return left + right; }
+};
+
+template <typename ValueType>
+struct min_aggregate {
+    using value_type = ValueType;
+    static inline ValueType lift(const ValueType& item) { return item; }
+    static inline ValueType identity() { return std::numeric_limits<ValueType>::max(); }
+    static inline ValueType combine(const ValueType& left, const ValueType& right) { return std::min(left, right); }
+};
+
+template <typename ValueType>
+struct max_aggregate {
+    using value_type = ValueType;
+    static inline ValueType lift(const ValueType& item) { return item; }
+    static inline ValueType identity() { return std::numeric_limits<ValueType>::lowest(); }
+    static inline ValueType combine(const ValueType& left, const ValueType& right) { return std::max(left, right); }
+};
+
+struct identity_projection {
+    template <typename ItemType>
+    inline const ItemType& operator()(const ItemType& item) const { return item; }
+};
+
+template <typename ItemType, typename Comparator = std::less<ItemType>, uint32_t chunk_size = 8,
+          typename Aggregate = no_aggregate, typename Projection = identity_projection>
 class packed_memory_array {
 public:
     static_assert(chunk_size > 0, "Chunk size must be greater than 0");
-    inline packed_memory_array() : items(chunk_size * 2) {}
+    using const_iterator = typename std::vector<std::optional<ItemType>>::const_iterator;
+    using aggregate_type = typename Aggregate::value_type;
+    static constexpr bool has_aggregate = !std::is_same_v<Aggregate, no_aggregate>;
+
+    inline packed_memory_array() : items(chunk_size * 2) { refresh_segment_stats(); }
+    inline packed_memory_array(const packed_memory_array&) = default;
+    inline packed_memory_array(packed_memory_array&& other) noexcept : packed_memory_array() { swap(other); }
+
+    inline packed_memory_array& operator=(packed_memory_array other) {
+        swap(other);
+        return *this;
+    }
+
+    inline void swap(packed_memory_array& other) {
+        if (!versions.records.empty())
+            touch(0, items.size());
+        if (!other.versions.records.empty())
+            other.touch(0, other.items.size());
+        ++version;
+        ++other.version;
+        std::swap(items, other.items);
+        std::swap(item_count, other.item_count);
+        std::swap(first_index, other.first_index);
+        std::swap(last_index, other.last_index);
+        std::swap(finger, other.finger);
+        std::swap(windowed, other.windowed);
+        std::swap(aggregate_tree, other.aggregate_tree);
+        std::swap(segment_counts, other.segment_counts);
+        std::swap(count_tree, other.count_tree);
+        std::swap(dirty_segments, other.dirty_segments);
+        std::swap(stats_stale, other.stats_stale);
+        refresh_segment_stats();
+        other.refresh_segment_stats();
+    }
 
     inline void push(const ItemType& item) {
-        int i = index_of(item);
-        int block_begin = (i / chunk_size) * chunk_size;
-        int block_end = block_begin + chunk_size;
-        int count = count_items(block_begin, block_end) + 1;
-        float lower, upper;
-        get_thresholds(&lower, &upper, tree_height());
-        float density = (float)count / (float)(block_end - block_begin);
-        if (density > upper) {
-            scan(block_begin, block_end, count, tree_height() - 1);
-            i = index_of(item);
+        if (item_count > 0 && !less(item, items[last_index].value())) {
+            append(item);
+            return;
         }
 
-        if (items[i]) {
-            int closest_gap = get_closest_gap(i);
-            bool is_on_right = closest_gap > i;
-            if (is_on_right && item > items[i])
-                i++;
-            else if (!is_on_right && item < items[i])
-                i--;
+        insert_near(finger, item);
+    }
 
-            is_on_right ? shift_right(i, closest_gap) : shift_left(i, closest_gap);
+    inline const_iterator insert(const_iterator hint, const ItemType& item) {
+        if (item_count > 0 && !less(item, items[last_index].value())) {
+            append(item);
+            return begin() + last_index;
         }
-        items[i] = item;
+
+        return begin() + insert_near(hint - begin(), item);
     }
 
-    inline void remove(const ItemType& target) {
-        int i = index_of(target);
-        if (!items[i] || items[i] != target)
+    template <typename Key = ItemType>
+    inline void remove(const Key& target) {
+        int i = gallop(target, finger);
+        finger = i;
+        if (!items[i] || !equal(items[i].value(), target))
             return;
 
-        items[i].reset();
-        int block_begin = (i / chunk_size) * chunk_size;
-        int block_end = block_begin + chunk_size;
-        int count = count_items(block_begin, block_end);
-        float lower, upper;
-        get_thresholds(&lower, &upper, tree_height());
-        float density = (float)count / (float)(block_end - block_begin);
-        if (density < lower)
-            scan(block_begin, block_end, count, tree_height() - 1);
+        remove_at(i);
     }
 
-    inline ItemType successor(const ItemType& target) const {
-        int i = index_of(target);
-        for (; i < items.size() && (!items[i] || items[i] <= target); ++i);
-        if (i >= items.size())
-            return target;
+    inline ItemType pop_min() {
+        ItemType item = std::move(items[first_index].value());
+        remove_at(first_index);
+        return item;
+    }
 
-        return items[i].value();
+    inline ItemType pop_max() {
+        ItemType item = std::move(items[last_index].value());
+        remove_at(last_index);
+        return item;
     }
 
-    inline int index_of(const ItemType& target) const {
-        int low = 0, high = items.size() - 1;
-        while (low <= high) {
-            int mid = low + (high - low) / 2;
-            for (; mid <= high && !items[mid]; ++mid);
-            if (mid > high) {
-                mid = low + (high - low) / 2;
-                for (; mid >= low && !items[mid]; --mid);
-                if (mid < low)
-                    return low;
+    inline const ItemType& min() const { return items[first_index].value(); }
+    inline const ItemType& max() const { return items[last_index].value(); }
+
+    inline void update(const ItemType& old_key, const ItemType& new_key) {
+        int i = index_of(old_key);
+        if (!items[i] || !equal(items[i].value(), old_key))
+            return;
+
+        int previous = i - 1;
+        for (; previous >= first_index && !items[previous]; --previous);
+        int next = i + 1;
+        for (; next <= last_index && !items[next]; ++next);
+
+        int destination = i;
+        if (previous >= first_index && less(new_key, items[previous].value())) {
+            int j = previous;
+            for (; j >= first_index && i - j <= (int)chunk_size && (!items[j] || !less(items[j].value(), new_key)); --j) {
+                if (items[j])
+                    destination = j;
+            }
+            if (j >= first_index && i - j > (int)chunk_size) {
+                remove(old_key);
+                push(new_key);
+                return;
             }
 
-            if (items[mid] < target)
-                low = mid + 1;
-            else if (items[mid] > target)
-                high = mid - 1;
-            else
-                return mid;
+            touch(destination, i + 1);
+            shift_right(destination, i);
+        } else if (next <= last_index && less(items[next].value(), new_key)) {
+            int j = next;
+            for (; j <= last_index && j - i <= (int)chunk_size && (!items[j] || !less(new_key, items[j].value())); ++j) {
+                if (items[j])
+                    destination = j;
+            }
+            if (j <= last_index && j - i > (int)chunk_size) {
+                remove(old_key);
+                push(new_key);
+                return;
+            }
+
+            touch(i, destination + 1);
+            shift_left(destination, i);
         }
 
-        return low == items.size() ? low - 1: low;
+        touch(destination, destination + 1);
+        items[destination] = new_key;
+        note_cleared(i);
+        finger = destination;
+        refresh_segment_stats();
     }
 
-    using const_iterator = typename std::vector<std::optional<ItemType>>::const_iterator;
+    inline void erase_range(const ItemType& first_key, const ItemType& last_key) {
+        if (item_count == 0 || less(last_key, first_key))
+            return;
+
+        int begin = lower_bound_index(first_key);
+        int end = begin;
+        for (; end <= last_index && (!items[end] || !less(last_key, items[end].value())); ++end);
+        if (begin == end)
+            return;
+
+        touch(begin, end);
+        for (int i = begin; i < end; ++i) {
+            if (items[i] && !less(items[i].value(), first_key)) {
+                items[i].reset();
+                --item_count;
+            }
+        }
+
+        shrink_bounds(begin, end);
+        rebalance(begin, end);
+        refresh_segment_stats();
+    }
+
+    inline void set_windowed(bool enabled) { windowed = enabled; }
+
+    inline void expire_before(const ItemType& cutoff) {
+        if (item_count == 0)
+            return;
+
+        int end = first_index;
+        for (; end <= last_index && (!items[end] || less(items[end].value(), cutoff)); ++end);
+        if (end == first_index)
+            return;
+
+        touch(first_index, end);
+        for (int i = first_index; i < end; ++i) {
+            if (items[i]) {
+                items[i].reset();
+                --item_count;
+            }
+        }
+
+        if (item_count == 0)
+            first_index = last_index = -1;
+        else
+            first_index = end;
+        finger = std::max(first_index, 0);
+        if (!windowed)
+            rebalance(0, end);
+        refresh_segment_stats();
+    }
+
+    template <typename Predicate>
+    inline void erase_if(Predicate predicate) {
+        touch(0, items.size());
+        int removed = 0;
+        for (auto& item : items) {
+            if (item && predicate(*item)) {
+                item.reset();
+                ++removed;
+            }
+        }
+        if (removed == 0) {
+            refresh_segment_stats();
+            return;
+        }
+
+        item_count -= removed;
+        float lower, upper;
+        get_thresholds(&lower, &upper, 0);
+        relayout(item_count, lower, upper);
+        restore_bounds();
+    }
+
+    template <typename Transform>
+    inline void transform_monotone(Transform transform) {
+        touch(0, items.size());
+        for (auto& item : items) {
+            if (item)
+                *item = transform(*item);
+        }
+        refresh_segment_stats();
+    }
+
+    template <typename Key = ItemType>
+    inline ItemType successor(const Key& target) const {
+        return successor_from(finger, target);
+    }
+
+    template <typename Key = ItemType>
+    inline ItemType successor(const_iterator hint, const Key& target) const {
+        return successor_from(hint - begin(), target);
+    }
+
+    template <typename Key = ItemType>
+    inline const_iterator find(const_iterator hint, const Key& target) const {
+        int i = gallop(target, hint - begin());
+        if (!items[i] || !equal(items[i].value(), target))
+            return end();
+
+        return begin() + i;
+    }
+
+    template <typename Key = ItemType>
+    inline const_iterator lower_bound(const_iterator hint, const Key& target) const {
+        if (item_count == 0)
+            return end();
+
+        int i = lower_bound_from(target, hint - begin(), first_index);
+        return i > last_index ? end() : begin() + i;
+    }
+
+    static inline packed_memory_array from_sorted(std::vector<ItemType> buffer) {
+        packed_memory_array result;
+        result.item_count = buffer.size();
+        float lower, upper;
+        result.get_thresholds(&lower, &upper, 0);
+        result.spread(buffer, result.item_count, lower, upper);
+        return result;
+    }
+
+    inline packed_memory_array merge_union(const packed_memory_array& other) const {
+        std::vector<ItemType> buffer;
+        buffer.reserve(item_count + other.item_count);
+        auto keep = [&](const ItemType& item) { buffer.push_back(item); };
+        merge_with(other, keep, keep, keep);
+        return from_sorted(std::move(buffer));
+    }
+
+    inline packed_memory_array intersect(const packed_memory_array& other) const {
+        std::vector<ItemType> buffer;
+        auto skip = [](const ItemType&) {};
+        auto keep = [&](const ItemType& item) { buffer.push_back(item); };
+        if (item_count <= other.item_count)
+            probe_into(other, keep, skip);
+        else
+            other.probe_into(*this, keep, skip);
+        return from_sorted(std::move(buffer));
+    }
+
+    inline packed_memory_array difference(const packed_memory_array& other) const {
+        std::vector<ItemType> buffer;
+        auto skip = [](const ItemType&) {};
+        auto keep = [&](const ItemType& item) { buffer.push_back(item); };
+        probe_into(other, skip, keep);
+        return from_sorted(std::move(buffer));
+    }
+
+    inline packed_memory_array split(const ItemType& key) {
+        if (item_count == 0)
+            return packed_memory_array();
+
+        int begin = lower_bound_index(key);
+        auto buffer = get_items(begin, items.size());
+        if (buffer.empty())
+            return packed_memory_array();
+
+        item_count -= buffer.size();
+        shrink_bounds(begin, items.size());
+        rebalance(begin, items.size());
+        refresh_segment_stats();
+        return from_sorted(std::move(buffer));
+    }
+
+    inline void join(packed_memory_array other) {
+        auto left = get_items(0, items.size());
+        auto right = other.get_items(0, other.items.size());
+        std::vector<ItemType> buffer;
+        buffer.reserve(left.size() + right.size());
+        std::merge(std::make_move_iterator(left.begin()), std::make_move_iterator(left.end()),
+                   std::make_move_iterator(right.begin()), std::make_move_iterator(right.end()),
+                   std::back_inserter(buffer), less<ItemType, ItemType>);
+
+        item_count = buffer.size();
+        float lower, upper;
+        get_thresholds(&lower, &upper, 0);
+        spread(buffer, item_count, lower, upper);
+    }
+
+    template <typename Key = ItemType>
+    inline aggregate_type aggregate(const Key& first_key, const Key& last_key) const {
+        static_assert(has_aggregate, "aggregate() requires an Aggregate template argument");
+        int begin = lower_bound_index(first_key);
+        int end = upper_bound_index(last_key);
+        if (begin >= end)
+            return Aggregate::identity();
+
+        int first_segment = begin / chunk_size;
+        int last_segment = (end - 1) / chunk_size;
+        if (first_segment == last_segment)
+            return fold_slots(begin, end);
+
+        aggregate_type result = fold_slots(begin, (first_segment + 1) * chunk_size);
+        result = Aggregate::combine(result, query_segments(first_segment + 1, last_segment));
+        return Aggregate::combine(result, fold_slots(last_segment * chunk_size, end));
+    }
+
+    inline std::vector<ItemType> bottom_k(int k) const {
+        std::vector<ItemType> result;
+        k = std::clamp(k, 0, item_count);
+        result.reserve(k);
+        for (int i = first_index; i >= 0 && i <= last_index && (int)result.size() < k; i = next_occupied(i))
+            result.push_back(items[i].value());
+
+        return result;
+    }
+
+    inline std::vector<ItemType> top_k(int k) const {
+        std::vector<ItemType> result;
+        k = std::clamp(k, 0, item_count);
+        result.reserve(k);
+        for (int i = last_index; i >= first_index && i >= 0 && (int)result.size() < k; --i) {
+            if (items[i])
+                result.push_back(items[i].value());
+        }
+
+        return result;
+    }
+
+    inline std::optional<ItemType> quantile(double q) const {
+        if (item_count == 0)
+            return std::nullopt;
+
+        int rank = std::clamp((int)(q * (item_count - 1)), 0, item_count - 1);
+        return items[select_slot(rank)].value();
+    }
+
+    struct count_estimate {
+        int estimate;
+        int lower;
+        int upper;
+    };
+
+    inline count_estimate estimate_count(const ItemType& first_key, const ItemType& last_key) const {
+        int begin = lower_bound_index(first_key);
+        int end = upper_bound_index(last_key);
+        if (begin >= end)
+            return {0, 0, 0};
+
+        int count = count_slots(begin, end);
+        return {count, count, count};
+    }
+
+    template <typename Random>
+    inline std::vector<ItemType> sample(int k, Random& random) const {
+        std::vector<ItemType> result;
+        if (item_count == 0 || k <= 0)
+            return result;
+
+        result.reserve(k);
+        std::uniform_int_distribution<int> rank(0, item_count - 1);
+        for (int i = 0; i < k; ++i)
+            result.push_back(items[select_slot(rank(random))].value());
+
+        return result;
+    }
+
+    inline int export_to(ItemType* out, int capacity) const {
+        int written = 0;
+        for (int i = first_index; i >= 0 && i <= last_index && written < capacity; i = next_occupied(i))
+            out[written++] = items[i].value();
+
+        return written;
+    }
+
+#if __cplusplus >= 202002L
+    inline int export_to(std::span<ItemType> out) const { return export_to(out.data(), out.size()); }
+#endif
+
+    struct column_view {
+        const std::optional<ItemType>* slots;
+        int length;
+        std::vector<uint64_t> validity;
+
+        inline bool valid(int i) const { return (validity[i / 64] >> (i % 64)) & 1; }
+        inline const ItemType& value(int i) const { return *slots[i]; }
+    };
+
+    inline column_view columns() const {
+        column_view view{items.data(), (int)items.size(), std::vector<uint64_t>((items.size() + 63) / 64)};
+        for (int i = std::max(first_index, 0); i <= last_index; ++i) {
+            if (items[i])
+                view.validity[i / 64] |= uint64_t(1) << (i % 64);
+        }
+
+        return view;
+    }
+
+    template <typename Key = ItemType>
+    inline int index_of(const Key& target) const {
+        if (item_count == 0)
+            return 0;
+
+        return index_of(target, first_index, last_index);
+    }
+
+    inline int size() const { return item_count; }
+    inline bool empty() const { return item_count == 0; }
+
     inline const_iterator begin() const { return items.begin(); }
     inline const_iterator end() const { return items.end(); }
 
+private:
+    using segment = std::vector<std::optional<ItemType>>;
+
+    struct version_record {
+        int slot_count;
+        int pending;
+        std::unordered_map<int, std::shared_ptr<const segment>> segments;
+    };
+
+    struct version_registry {
+        std::vector<std::weak_ptr<version_record>> records;
+        std::mutex lock;
+
+        version_registry() = default;
+        version_registry(const version_registry&) {}
+        version_registry& operator=(const version_registry&) = delete;
+    };
+
+public:
+    class snapshot_view {
+    public:
+        class const_iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::optional<ItemType>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const value_type*;
+            using reference = const value_type&;
+
+            inline const_iterator(const snapshot_view* owner, int index) : owner(owner), index(index) { load(); }
+
+            inline reference operator*() const { return data[index % chunk_size]; }
+            inline pointer operator->() const { return &data[index % chunk_size]; }
+            inline const_iterator& operator++() {
+                if (++index % chunk_size == 0)
+                    load();
+                return *this;
+            }
+            inline const_iterator operator++(int) {
+                const_iterator previous = *this;
+                ++*this;
+                return previous;
+            }
+            inline bool operator==(const const_iterator& other) const { return index == other.index; }
+            inline bool operator!=(const const_iterator& other) const { return index != other.index; }
+
+        private:
+            const snapshot_view* owner;
+            int index;
+            const std::optional<ItemType>* data = nullptr;
+
+            inline void load() {
+                if (index < owner->record->slot_count)
+                    data = owner->segment_data(index / chunk_size);
+            }
+        };
+
+        inline const_iterator begin() const { return const_iterator(this, 0); }
+        inline const_iterator end() const { return const_iterator(this, record->slot_count); }
+
+        inline ItemType successor(const ItemType& target) const {
+            int low = 0, high = record->slot_count / chunk_size;
+            while (low < high) {
+                int mid = low + (high - low) / 2;
+                int probe = mid, last = -1;
+                const std::optional<ItemType>* data = nullptr;
+                for (; probe < high && last < 0; ++probe) {
+                    data = segment_data(probe);
+                    for (last = chunk_size - 1; last >= 0 && !data[last]; --last);
+                }
+                if (last < 0)
+                    high = mid;
+                else if (less(target, data[last].value()))
+                    high = probe - 1;
+                else
+                    low = probe;
+            }
+
+            auto it = const_iterator(this, low * chunk_size);
+            for (; it != end() && (!*it || !less(target, it->value())); ++it);
+            if (it == end())
+                return target;
+
+            return it->value();
+        }
+
+    private:
+        friend class packed_memory_array;
+
+        const packed_memory_array* owner;
+        std::shared_ptr<version_record> record;
+
+        inline snapshot_view(const packed_memory_array* owner, std::shared_ptr<version_record> record)
+            : owner(owner), record(std::move(record)) {}
+
+        inline const std::optional<ItemType>* segment_data(int segment_index) const {
+            auto it = record->segments.find(segment_index);
+            if (it != record->segments.end())
+                return it->second->data();
+
+            return owner->items.data() + segment_index * chunk_size;
+        }
+    };
+
+    class cursor {
+    public:
+        inline std::optional<ItemType> next() {
+            int i = std::max(index + 1, owner->first_index);
+            if (version != owner->version && last) {
+                i = owner->lower_bound_from(*last, index, owner->first_index);
+                for (int skipped = 0; i >= 0 && i <= owner->last_index; ++i) {
+                    if (!owner->items[i])
+                        continue;
+                    if (skipped == repeats || !equal(owner->items[i].value(), *last))
+                        break;
+                    ++skipped;
+                }
+            } else {
+                for (; i >= 0 && i <= owner->last_index && !owner->items[i]; ++i);
+            }
+
+            version = owner->version;
+            if (i < 0 || i > owner->last_index) {
+                index = owner->last_index;
+                return std::nullopt;
+            }
+
+            repeats = last && equal(owner->items[i].value(), *last) ? repeats + 1 : 1;
+            index = i;
+            last = owner->items[i];
+            return last;
+        }
+
+    private:
+        friend class packed_memory_array;
+
+        const packed_memory_array* owner;
+        std::optional<ItemType> last;
+        int index = -1;
+        int repeats = 0;
+        uint64_t version;
+
+        inline cursor(const packed_memory_array* owner) : owner(owner), version(owner->version) {}
+    };
+
+    class value_iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = ItemType;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const ItemType*;
+        using reference = const ItemType&;
+
+        inline value_iterator() = default;
+
+        inline reference operator*() const { return *slots[index]; }
+        inline pointer operator->() const { return &*slots[index]; }
+        inline value_iterator& operator++() {
+            for (++index; index < limit && !slots[index]; ++index);
+            return *this;
+        }
+        inline value_iterator operator++(int) {
+            value_iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+        inline value_iterator& operator--() {
+            for (--index; !slots[index]; --index);
+            return *this;
+        }
+        inline value_iterator operator--(int) {
+            value_iterator previous = *this;
+            --*this;
+            return previous;
+        }
+        inline bool operator==(const value_iterator& other) const { return index == other.index; }
+        inline bool operator!=(const value_iterator& other) const { return index != other.index; }
+
+    private:
+        friend class packed_memory_array;
+
+        const std::optional<ItemType>* slots = nullptr;
+        int index = 0;
+        int limit = 0;
+
+        inline value_iterator(const std::optional<ItemType>* slots, int index, int limit)
+            : slots(slots), index(index), limit(limit) {}
+    };
+
+    class value_range {
+    public:
+        inline value_range() = default;
+
+        inline value_iterator begin() const { return first; }
+        inline value_iterator end() const { return last; }
+        inline int size() const { return count; }
+        inline bool empty() const { return count == 0; }
+
+    private:
+        friend class packed_memory_array;
+
+        value_iterator first;
+        value_iterator last;
+        int count = 0;
+
+        inline value_range(value_iterator first, value_iterator last, int count) : first(first), last(last), count(count) {}
+    };
+
+    inline value_range values() const {
+        int limit = last_index + 1;
+        return value_range(value_iterator(items.data(), std::max(first_index, 0), limit),
+                           value_iterator(items.data(), limit, limit), item_count);
+    }
+
+    inline value_range subrange(const ItemType& first_key, const ItemType& last_key) const {
+        int limit = last_index + 1;
+        int begin = lower_bound_index(first_key);
+        int end = upper_bound_index(last_key);
+        for (; begin < end && !items[begin]; ++begin);
+        if (item_count == 0 || begin >= end)
+            return value_range(value_iterator(items.data(), limit, limit), value_iterator(items.data(), limit, limit), 0);
+
+        return value_range(value_iterator(items.data(), begin, limit), value_iterator(items.data(), end, limit),
+                           count_slots(begin, end));
+    }
+
+    inline cursor make_cursor() const { return cursor(this); }
+
+    inline snapshot_view snapshot() const {
+        auto record = std::make_shared<version_record>();
+        record->slot_count = items.size();
+        record->pending = items.size() / chunk_size;
+        std::lock_guard<std::mutex> guard(versions.lock);
+        versions.records.push_back(record);
+        return snapshot_view(this, std::move(record));
+    }
+
 private:
     std::vector<std::optional<ItemType>> items;
+    int item_count = 0;
+    int first_index = -1;
+    int last_index = -1;
+    int finger = 0;
+    bool windowed = false;
+    uint64_t version = 0;
+    std::vector<aggregate_type> aggregate_tree;
+    std::vector<int> segment_counts;
+    std::vector<int> count_tree;
+    std::vector<int> dirty_segments;
+    bool stats_stale = true;
+    mutable version_registry versions;
 
 private:
-    inline void scan(int begin, int end, int accum_count, int depth) {
+    inline void scan(int begin, int end, int accum_count, int depth, bool append = false) {
         int curr_block_size = end - begin;
         bool is_left_child = (begin / curr_block_size) % 2 == 0;
         int sibling_begin = is_left_child ? end : begin - curr_block_size;
@@ -107,38 +752,287 @@ private:
             int parent_begin = is_left_child ? begin : sibling_begin;
             int parent_end = is_left_child ? sibling_end : end;
             auto buffer = get_items(parent_begin, parent_end);
-            rearrange_items(parent_begin, parent_end, buffer);
+            rearrange_items(parent_begin, parent_end, buffer, append);
             return;
         }
 
         if (depth == 0) {
-            auto buffer = get_items(0, items.size());
-            if (density > upper)
-                items.resize(items.size() * 2);
-            else if (density < lower && items.size() > chunk_size * 2)
-                items.resize(items.size() / 2);
-
-            if (!buffer.empty())
-                rearrange_items(0, items.size(), buffer);
-
+            relayout(accum_count + sibling_count, lower, upper, append);
             return;
         }
 
         int parent_begin = is_left_child ? begin : sibling_begin;
         int parent_end = is_left_child ? sibling_end : end;
-        scan(parent_begin, parent_end, accum_count + sibling_count, depth - 1);
+        scan(parent_begin, parent_end, accum_count + sibling_count, depth - 1, append);
+    }
+
+    template <typename Probe>
+    inline int index_of(const Probe& target, int low, int high) const {
+        while (low <= high) {
+            int mid = low + (high - low) / 2;
+            for (; mid <= high && !items[mid]; ++mid);
+            if (mid > high) {
+                mid = low + (high - low) / 2;
+                for (; mid >= low && !items[mid]; --mid);
+                if (mid < low)
+                    return low;
+            }
+
+            if (less(items[mid].value(), target))
+                low = mid + 1;
+            else if (less(target, items[mid].value()))
+                high = mid - 1;
+            else
+                return mid;
+        }
+
+        return low == (int)items.size() ? low - 1: low;
+    }
+
+    template <typename Probe>
+    inline int gallop(const Probe& target, int hint) const {
+        if (item_count == 0)
+            return 0;
+
+        int probe = std::clamp(hint, first_index, last_index);
+        for (; !items[probe]; ++probe);
+
+        int low = first_index, high = last_index;
+        if (less(items[probe].value(), target)) {
+            low = probe + 1;
+            for (int step = 1; ; step *= 2) {
+                int next = probe + step;
+                for (; next <= last_index && !items[next]; ++next);
+                if (next > last_index)
+                    break;
+                if (!less(items[next].value(), target)) {
+                    high = next;
+                    break;
+                }
+                low = next + 1;
+                probe = next;
+            }
+        } else {
+            high = probe;
+            for (int step = 1; ; step *= 2) {
+                int next = probe - step;
+                for (; next >= first_index && !items[next]; --next);
+                if (next < first_index)
+                    break;
+                if (less(items[next].value(), target)) {
+                    low = next + 1;
+                    break;
+                }
+                high = next;
+                probe = next;
+            }
+        }
+
+        return index_of(target, low, high);
+    }
+
+    inline int next_occupied(int i) const {
+        for (++i; i <= last_index && !items[i]; ++i);
+        return i;
+    }
+
+    template <typename OnLeft, typename OnBoth, typename OnRight>
+    inline void merge_with(const packed_memory_array& other, OnLeft on_left, OnBoth on_both, OnRight on_right) const {
+        int i = first_index, j = other.first_index;
+        while (i >= 0 && i <= last_index && j >= 0 && j <= other.last_index) {
+            const ItemType& left = items[i].value();
+            const ItemType& right = other.items[j].value();
+            if (less(left, right)) {
+                on_left(left);
+                i = next_occupied(i);
+            } else if (less(right, left)) {
+                on_right(right);
+                j = other.next_occupied(j);
+            } else {
+                on_both(left);
+                i = next_occupied(i);
+                j = other.next_occupied(j);
+            }
+        }
+
+        for (; i >= 0 && i <= last_index; i = next_occupied(i))
+            on_left(items[i].value());
+        for (; j >= 0 && j <= other.last_index; j = other.next_occupied(j))
+            on_right(other.items[j].value());
+    }
+
+    template <typename OnFound, typename OnMissing>
+    inline void probe_into(const packed_memory_array& other, OnFound on_found, OnMissing on_missing) const {
+        if ((long long)item_count * 32 >= other.item_count) {
+            auto skip = [](const ItemType&) {};
+            merge_with(other, on_missing, on_found, skip);
+            return;
+        }
+
+        int j = other.first_index;
+        for (int i = first_index; i >= 0 && i <= last_index; i = next_occupied(i)) {
+            const ItemType& item = items[i].value();
+            if (j >= 0 && j <= other.last_index && less(other.items[j].value(), item))
+                j = other.lower_bound_from(item, j, j);
+            if (j >= 0 && j <= other.last_index && equal(item, other.items[j].value())) {
+                on_found(item);
+                j = other.next_occupied(j);
+            } else {
+                on_missing(item);
+            }
+        }
+    }
+
+    template <typename Probe>
+    inline int lower_bound_from(const Probe& target, int hint, int floor) const {
+        int i = std::max(gallop(target, hint), floor);
+        if (i <= last_index && items[i] && less(items[i].value(), target))
+            ++i;
+        for (int j = i - 1; j >= floor; --j) {
+            if (!items[j])
+                continue;
+            if (less(items[j].value(), target))
+                break;
+            i = j;
+        }
+        for (; i <= last_index && !items[i]; ++i);
+
+        return i;
+    }
+
+    template <typename Probe>
+    inline ItemType successor_from(int hint, const Probe& target) const {
+        static_assert(std::is_constructible_v<ItemType, const Probe&>, "successor() requires a probe convertible to ItemType");
+        int i = gallop(target, hint);
+        for (; i <= last_index && (!items[i] || !less(target, items[i].value())); ++i);
+        if (i > last_index)
+            return ItemType(target);
+
+        return items[i].value();
+    }
+
+    inline int insert_near(int hint, const ItemType& item) {
+        int i = gallop(item, hint);
+        int block_begin = (i / chunk_size) * chunk_size;
+        int block_end = block_begin + chunk_size;
+        int count = count_items(block_begin, block_end) + 1;
+        float lower, upper;
+        get_thresholds(&lower, &upper, tree_height());
+        float density = (float)count / (float)(block_end - block_begin);
+        if (density > upper) {
+            scan(block_begin, block_end, count, tree_height() - 1);
+            i = gallop(item, i);
+        }
+
+        if (items[i]) {
+            int closest_gap = get_closest_gap(i);
+            bool is_on_right = closest_gap > i;
+            if (is_on_right && less(items[i].value(), item))
+                i++;
+            else if (!is_on_right && less(item, items[i].value()))
+                i--;
+
+            touch(std::min(i, closest_gap), std::max(i, closest_gap) + 1);
+            is_on_right ? shift_right(i, closest_gap) : shift_left(i, closest_gap);
+            note_filled(closest_gap);
+        }
+        touch(i, i + 1);
+        items[i] = item;
+        ++item_count;
+        note_filled(i);
+        finger = i;
+        refresh_segment_stats();
+        return i;
+    }
+
+    inline void append(const ItemType& item) {
+        if (last_index + 1 == (int)items.size()) {
+            int block_begin = (last_index / chunk_size) * chunk_size;
+            int block_end = block_begin + chunk_size;
+            scan(block_begin, block_end, count_items(block_begin, block_end) + 1, tree_height() - 1, true);
+        }
+
+        int i = last_index + 1;
+        touch(i, i + 1);
+        items[i] = item;
+        ++item_count;
+        note_filled(i);
+        finger = i;
+        refresh_segment_stats();
+    }
+
+    inline void remove_at(int i) {
+        touch(i, i + 1);
+        items[i].reset();
+        --item_count;
+        note_cleared(i);
+        int block_begin = (i / chunk_size) * chunk_size;
+        int block_end = block_begin + chunk_size;
+        int count = count_items(block_begin, block_end);
+        float lower, upper;
+        get_thresholds(&lower, &upper, tree_height());
+        float density = (float)count / (float)(block_end - block_begin);
+        if (density < lower && !windowed)
+            scan(block_begin, block_end, count, tree_height() - 1);
+        refresh_segment_stats();
     }
 
-    inline void rearrange_items(int begin, int end, std::vector<ItemType>& buffer) {
-        int length = end - begin;
-        float step = (float)length / (float)buffer.size();
-        float pos = 0.0f;
-        for (auto& item : buffer) {
-            items[begin + (int)std::round(pos)] = std::move(item);
-            pos += step;
+    inline void rebalance(int begin, int end) {
+        int window_size = chunk_size;
+        for (; begin / window_size != (end - 1) / window_size; window_size *= 2);
+        int window_begin = (begin / window_size) * window_size;
+        int window_end = window_begin + window_size;
+        int depth = tree_height() - (int)std::log2(window_size / chunk_size);
+        int count = count_items(window_begin, window_end);
+        float lower, upper;
+        get_thresholds(&lower, &upper, depth);
+        float density = (float)count / (float)window_size;
+
+        if (lower <= density && density <= upper) {
+            auto buffer = get_items(window_begin, window_end);
+            rearrange_items(window_begin, window_end, buffer);
+        } else if (depth == 0) {
+            relayout(count, lower, upper);
+        } else {
+            scan(window_begin, window_end, count, depth - 1);
         }
     }
 
+    inline void relayout(int count, float lower, float upper, bool append = false) {
+        auto buffer = get_items(0, items.size());
+        spread(buffer, count, lower, upper, append);
+    }
+
+    inline void spread(std::vector<ItemType>& buffer, int count, float lower, float upper, bool append = false) {
+        int new_size = items.size();
+        for (; (float)count / (float)new_size > upper; new_size *= 2);
+        for (; !windowed && (float)count / (float)new_size < lower && (float)count / (float)(new_size / 2) <= upper
+               && new_size > (int)chunk_size * 2; new_size /= 2);
+        items.resize(new_size);
+        first_index = last_index = -1;
+        stats_stale = true;
+
+        if (!buffer.empty())
+            rearrange_items(0, items.size(), buffer, append);
+        refresh_segment_stats();
+    }
+
+    inline void rearrange_items(int begin, int end, std::vector<ItemType>& buffer, bool append = false) {
+        long long length = end - begin;
+        long long count = buffer.size();
+        if (append)
+            length -= (length - count + 1) / 2;
+        for (long long k = 0; k < count; ++k)
+            items[begin + (int)(k * length / count)] = std::move(buffer[k]);
+
+        if (count == 0)
+            return;
+        if (first_index < 0 || first_index >= begin)
+            first_index = begin;
+        if (last_index < end)
+            last_index = begin + (int)((count - 1) * length / count);
+    }
+
     inline void get_thresholds(float* lower, float* upper, int depth) const {
         *lower = 0.5f - 0.25f * ((float)depth / tree_height());
         *upper = 0.75f + 0.25f * ((float)depth / tree_height());
@@ -146,6 +1040,7 @@ private:
     inline int tree_height() const { return std::log2(items.size() / chunk_size); }
 
     inline std::vector<ItemType> get_items(int begin, int end) {
+        touch(begin, end);
         std::vector<ItemType> buffer;
         for (int i = begin; i < end; ++i) {
             if (items[i]) {
@@ -157,6 +1052,209 @@ private:
         return buffer;
     }
 
+    inline void touch(int begin, int end) {
+        ++version;
+        if (!stats_stale) {
+            for (int segment_index = begin / chunk_size; segment_index * (int)chunk_size < end; ++segment_index)
+                dirty_segments.push_back(segment_index);
+            if (dirty_segments.size() * chunk_size > items.size()) {
+                stats_stale = true;
+                dirty_segments.clear();
+            }
+        }
+
+        auto& records = versions.records;
+        if (records.empty())
+            return;
+
+        for (int segment_index = begin / chunk_size; segment_index * (int)chunk_size < end; ++segment_index) {
+            std::shared_ptr<const segment> copy;
+            for (auto& weak_record : records) {
+                auto record = weak_record.lock();
+                if (!record || segment_index * (int)chunk_size >= record->slot_count || record->segments.count(segment_index))
+                    continue;
+
+                if (!copy) {
+                    auto segment_begin = items.begin() + segment_index * chunk_size;
+                    copy = std::make_shared<const segment>(segment_begin, segment_begin + chunk_size);
+                }
+                record->segments.emplace(segment_index, copy);
+                --record->pending;
+            }
+        }
+
+        records.erase(std::remove_if(records.begin(), records.end(), [](auto&& weak_record) {
+            auto record = weak_record.lock();
+            return !record || record->pending == 0;
+        }), records.end());
+    }
+
+    inline aggregate_type fold_slots(int begin, int end) const {
+        aggregate_type result = Aggregate::identity();
+        for (int i = begin; i < end; ++i) {
+            if (items[i])
+                result = Aggregate::combine(result, Aggregate::lift(items[i].value()));
+        }
+
+        return result;
+    }
+
+    inline aggregate_type query_segments(int begin, int end) const {
+        int leaves = items.size() / chunk_size;
+        aggregate_type left = Aggregate::identity(), right = Aggregate::identity();
+        for (begin += leaves, end += leaves; begin < end; begin /= 2, end /= 2) {
+            if (begin & 1)
+                left = Aggregate::combine(left, aggregate_tree[begin++]);
+            if (end & 1)
+                right = Aggregate::combine(aggregate_tree[--end], right);
+        }
+
+        return Aggregate::combine(left, right);
+    }
+
+    inline void refresh_segment_stats() {
+        int leaves = items.size() / chunk_size;
+        if (stats_stale || (int)segment_counts.size() != leaves) {
+            segment_counts.assign(leaves, 0);
+            count_tree.assign(leaves + 1, 0);
+            for (int node = 1; node <= leaves; ++node) {
+                segment_counts[node - 1] = count_items((node - 1) * chunk_size, node * chunk_size);
+                count_tree[node] += segment_counts[node - 1];
+                int parent = node + (node & -node);
+                if (parent <= leaves)
+                    count_tree[parent] += count_tree[node];
+            }
+
+            if constexpr (has_aggregate) {
+                aggregate_tree.assign(2 * leaves, Aggregate::identity());
+                for (int segment_index = 0; segment_index < leaves; ++segment_index)
+                    aggregate_tree[leaves + segment_index] = fold_slots(segment_index * chunk_size, (segment_index + 1) * chunk_size);
+                for (int node = leaves - 1; node > 0; --node)
+                    aggregate_tree[node] = Aggregate::combine(aggregate_tree[2 * node], aggregate_tree[2 * node + 1]);
+            }
+
+            stats_stale = false;
+            dirty_segments.clear();
+            return;
+        }
+
+        for (int segment_index : dirty_segments) {
+            int count = count_items(segment_index * chunk_size, (segment_index + 1) * chunk_size);
+            for (int node = segment_index + 1; node <= leaves; node += node & -node)
+                count_tree[node] += count - segment_counts[segment_index];
+            segment_counts[segment_index] = count;
+
+            if constexpr (has_aggregate) {
+                int node = leaves + segment_index;
+                aggregate_tree[node] = fold_slots(segment_index * chunk_size, (segment_index + 1) * chunk_size);
+                for (node /= 2; node > 0; node /= 2)
+                    aggregate_tree[node] = Aggregate::combine(aggregate_tree[2 * node], aggregate_tree[2 * node + 1]);
+            }
+        }
+        dirty_segments.clear();
+    }
+
+    inline int count_prefix(int segments) const {
+        int count = 0;
+        for (; segments > 0; segments -= segments & -segments)
+            count += count_tree[segments];
+
+        return count;
+    }
+
+    inline int select_slot(int rank) const {
+        int leaves = segment_counts.size();
+        int segment_index = 0;
+        for (int step = leaves; step > 0; step /= 2) {
+            if (segment_index + step <= leaves && count_tree[segment_index + step] <= rank) {
+                segment_index += step;
+                rank -= count_tree[segment_index];
+            }
+        }
+
+        int i = segment_index * chunk_size;
+        for (; !items[i] || rank-- > 0; ++i);
+        return i;
+    }
+
+    inline void note_filled(int i) {
+        if (first_index < 0 || i < first_index)
+            first_index = i;
+        if (i > last_index)
+            last_index = i;
+    }
+
+    inline void note_cleared(int i) {
+        if (item_count == 0) {
+            first_index = last_index = -1;
+            return;
+        }
+
+        if (i == first_index)
+            for (; !items[first_index]; ++first_index);
+        if (i == last_index)
+            for (; !items[last_index]; --last_index);
+    }
+
+    inline void shrink_bounds(int begin, int end) {
+        if (item_count == 0) {
+            first_index = last_index = -1;
+            return;
+        }
+
+        if (first_index >= begin)
+            for (first_index = end; !items[first_index]; ++first_index);
+        if (last_index < end)
+            for (last_index = begin - 1; !items[last_index]; --last_index);
+    }
+
+    inline void restore_bounds() {
+        if (item_count == 0) {
+            first_index = last_index = -1;
+            return;
+        }
+
+        for (first_index = 0; !items[first_index]; ++first_index);
+        for (last_index = items.size() - 1; !items[last_index]; --last_index);
+    }
+
+    template <typename Probe>
+    inline int lower_bound_index(const Probe& target) const {
+        if (item_count == 0)
+            return 0;
+
+        int i = index_of(target);
+        if (i == last_index && less(items[i].value(), target))
+            return i + 1;
+
+        for (int j = i - 1; j >= first_index; --j) {
+            if (!items[j])
+                continue;
+            if (less(items[j].value(), target))
+                break;
+            i = j;
+        }
+
+        return i;
+    }
+
+    template <typename Probe>
+    inline int upper_bound_index(const Probe& target) const {
+        int i = index_of(target);
+        for (; i <= last_index && (!items[i] || !less(target, items[i].value())); ++i);
+        return i;
+    }
+
+    inline int count_slots(int begin, int end) const {
+        int first_segment = begin / chunk_size + 1;
+        int last_segment = end / chunk_size;
+        if (first_segment >= last_segment)
+            return count_items(begin, end);
+
+        return count_items(begin, first_segment * chunk_size) + count_prefix(last_segment) - count_prefix(first_segment)
+               + count_items(last_segment * chunk_size, end);
+    }
+
     inline int count_items(int begin, int end) const {
         return std::count_if(items.begin() + begin, items.begin() + end, [](auto&& item) {
             return item;
@@ -174,26 +1272,65 @@ private:
 
     inline int get_closest_gap(const int index) const {
         for (int offset = 1; ; offset++) {
-            if (index + offset < items.size() && !items[index + offset])
+            if (index + offset < (int)items.size() && !items[index + offset])
                 return index + offset;
             if (index - offset >= 0 && !items[index - offset])
                 return index - offset;
         }
     }
 
-    friend inline bool operator<(const std::optional<ItemType>& left, const std::optional<ItemType>& right) {
-        return Comparator()(left.value(), right.value());
-    }
-    friend inline bool operator>(const std::optional<ItemType>& left, const std::optional<ItemType>& right) {
-        return right < left;
-    }
-    friend inline bool operator==(const std::optional<ItemType>& left, const std::optional<ItemType>& right) {
-        return !(right < left) && !(left < right);
+    template <typename Probe>
+    static inline decltype(auto) key_of(const Probe& probe) {
+        if constexpr (std::is_same_v<Probe, ItemType>)
+            return Projection()(probe);
+        else
+            return probe;
     }
-    friend inline bool operator!=(const std::optional<ItemType>& left, const std::optional<ItemType>& right) {
-        return !(left == right);
+
+    template <typename Left, typename Right>
+    static inline bool less(const Left& left, const Right& right) {
+        return Comparator()(key_of(left), key_of(right));
     }
-    friend inline bool operator<=(const std::optional<ItemType>& left, const std::optional<ItemType>& right) {
-        return left < right || left == right;
+
+    template <typename Left, typename Right>
+    static inline bool equal(const Left& left, const Right& right) {
+        return !less(left, right) && !less(right, left);
     }
 };
+
+template <typename ItemType, typename Comparator, uint32_t chunk_size, typename Aggregate, typename Projection,
+          typename Delta, typename Callback>
+inline void window_join(const packed_memory_array<ItemType, Comparator, chunk_size, Aggregate, Projection>& left,
+                        const packed_memory_array<ItemType, Comparator, chunk_size, Aggregate, Projection>& right,
+                        const Delta& delta, Callback callback) {
+    auto outside = [&delta](const auto& from, const auto& to) {
+        return Comparator()(from, to) && (from < to ? to - from : from - to) > delta;
+    };
+
+    auto window_begin = right.begin();
+    for (auto it = left.begin(); it != left.end(); ++it) {
+        if (!*it)
+            continue;
+
+        const auto& key = Projection()(it->value());
+        for (; window_begin != right.end(); ++window_begin) {
+            if (!*window_begin)
+                continue;
+
+            const auto& other = Projection()(window_begin->value());
+            if (!outside(other, key))
+                break;
+        }
+
+        for (auto candidate = window_begin; candidate != right.end(); ++candidate) {
+            if (!*candidate)
+                continue;
+
+            const auto& other = Projection()(candidate->value());
+            if (outside(key, other))
+                break;
+
+            callback(it->value(), candidate->value());
+        }
+    }
+}
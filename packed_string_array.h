@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "packed_memory_array.h"
+
+struct string_slot {
+    uint64_t prefix;
+    uint32_t length;
+    const char* data;
+};
+
+struct string_slot_less {
+    inline bool operator()(const string_slot& left, const string_slot& right) const {
+        if (left.prefix != right.prefix)
+            return left.prefix < right.prefix;
+
+        uint32_t common = std::min(left.length, right.length);
+        if (common > sizeof(uint64_t)) {
+            int order = std::memcmp(left.data + sizeof(uint64_t), right.data + sizeof(uint64_t), common - sizeof(uint64_t));
+            if (order != 0)
+                return order < 0;
+        }
+
+        return left.length < right.length;
+    }
+};
+
+template <uint32_t chunk_size = 8>
+class packed_string_array {
+public:
+    inline void push(std::string_view value) {
+        pma.push(make_slot(store(value)));
+        live_bytes += value.size();
+    }
+
+    inline void remove(std::string_view value) {
+        int count = pma.size();
+        pma.remove(make_slot(value));
+        if (pma.size() == count)
+            return;
+
+        live_bytes -= value.size();
+        if (arena_bytes - live_bytes > live_bytes && arena_bytes - live_bytes > block_size)
+            compact();
+    }
+
+    inline bool contains(std::string_view value) const {
+        return pma.find(pma.begin(), make_slot(value)) != pma.end();
+    }
+
+    inline std::string successor(std::string_view value) const {
+        string_slot slot = pma.successor(make_slot(value));
+        return std::string(slot.data, slot.length);
+    }
+
+    template <typename Callback>
+    inline void for_each(Callback callback) const {
+        for (const string_slot& slot : pma.values())
+            callback(std::string_view(slot.data, slot.length));
+    }
+
+    inline int size() const { return pma.size(); }
+    inline bool empty() const { return pma.empty(); }
+
+    inline void compact() {
+        std::vector<std::unique_ptr<char[]>> old_blocks;
+        old_blocks.swap(blocks);
+        current_block = nullptr;
+        block_used = block_size;
+        arena_bytes = 0;
+        pma.transform_monotone([this](const string_slot& slot) {
+            return make_slot(store(std::string_view(slot.data, slot.length)));
+        });
+    }
+
+private:
+    static constexpr size_t block_size = 1 << 16;
+
+    packed_memory_array<string_slot, string_slot_less, chunk_size> pma;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* current_block = nullptr;
+    size_t block_used = block_size;
+    size_t arena_bytes = 0;
+    size_t live_bytes = 0;
+
+    inline std::string_view store(std::string_view value) {
+        arena_bytes += value.size();
+        if (value.size() > block_size / 4) {
+            blocks.emplace_back(new char[value.size()]);
+            std::memcpy(blocks.back().get(), value.data(), value.size());
+            return std::string_view(blocks.back().get(), value.size());
+        }
+
+        if (!current_block || block_used + value.size() > block_size) {
+            blocks.emplace_back(new char[block_size]);
+            current_block = blocks.back().get();
+            block_used = 0;
+        }
+
+        char* data = current_block + block_used;
+        std::memcpy(data, value.data(), value.size());
+        block_used += value.size();
+        return std::string_view(data, value.size());
+    }
+
+    static inline string_slot make_slot(std::string_view value) {
+        uint64_t prefix = 0;
+        for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+            prefix <<= 8;
+            if (i < value.size())
+                prefix |= (unsigned char)value[i];
+        }
+
+        return {prefix, (uint32_t)value.size(), value.data()};
+    }
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "packed_memory_array.h"
+
+template <uint32_t chunk_size = 8>
+class postings_list {
+public:
+    inline void add(uint32_t document) {
+        if (pma.empty() || pma.find(pma.begin(), document) == pma.end())
+            pma.push(document);
+    }
+
+    inline void remove(uint32_t document) { pma.remove(document); }
+
+    inline bool contains(uint32_t document) const {
+        return !pma.empty() && pma.find(pma.begin(), document) != pma.end();
+    }
+
+    template <typename Callback>
+    inline void for_each(Callback callback) const {
+        for (uint32_t document : pma.values())
+            callback(document);
+    }
+
+    inline int size() const { return pma.size(); }
+    inline bool empty() const { return pma.empty(); }
+
+    static inline std::vector<uint32_t> intersect(std::vector<const postings_list*> lists) {
+        std::vector<uint32_t> result;
+        if (lists.empty())
+            return result;
+
+        std::sort(lists.begin(), lists.end(), [](const postings_list* left, const postings_list* right) {
+            return left->size() < right->size();
+        });
+        if (lists.front()->empty())
+            return result;
+
+        std::vector<typename list_type::const_iterator> hints;
+        for (const postings_list* list : lists)
+            hints.push_back(list->pma.begin());
+
+        uint32_t target = lists.front()->pma.min();
+        size_t agreed = 0;
+        for (size_t i = 0;; i = (i + 1) % lists.size()) {
+            const list_type& pma = lists[i]->pma;
+            hints[i] = pma.lower_bound(hints[i], target);
+            if (hints[i] == pma.end())
+                return result;
+
+            if (hints[i]->value() != target) {
+                target = hints[i]->value();
+                agreed = 0;
+            }
+            if (++agreed == lists.size()) {
+                result.push_back(target);
+                if (target == std::numeric_limits<uint32_t>::max())
+                    return result;
+
+                ++target;
+                agreed = 0;
+            }
+        }
+    }
+
+private:
+    using list_type = packed_memory_array<uint32_t, std::less<uint32_t>, chunk_size>;
+
+    list_type pma;
+};